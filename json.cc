@@ -4,6 +4,18 @@
 #include <limits>
 #include <cmath>
 #include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <mutex>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+// the SSSE3 UTF-8 kernel carries its own target attribute and is picked at runtime,
+// so plain x86 builds get it without -mssse3
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define TINY_JSON_UTF8_KERNEL 1
+#include <tmmintrin.h>
+#endif
 namespace tiny_json {
 static constexpr size_t MAX_DEPTH = 200;
 struct NullStruct {
@@ -62,13 +74,13 @@ static void dump(const std::string &value,std::string &out) {
             snprintf(buf,sizeof buf,"\\u%04x",ch);
             out += buf;
         }
-        else if(static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i + 1]) == 0x80
-            && static_cast<uint8_t>(value[i + 2]) == 0xa8) {
+        else if(static_cast<uint8_t>(ch) == 0xe2 && i + 2 < value.size()
+            && static_cast<uint8_t>(value[i + 1]) == 0x80 && static_cast<uint8_t>(value[i + 2]) == 0xa8) {
                 out += "\\u2028";
                 i += 2;
         }
-        else if(static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i + 1]) == 0x80
-            && static_cast<uint8_t>(value[i + 2]) == 0xa9) {
+        else if(static_cast<uint8_t>(ch) == 0xe2 && i + 2 < value.size()
+            && static_cast<uint8_t>(value[i + 1]) == 0x80 && static_cast<uint8_t>(value[i + 2]) == 0xa9) {
                 out += "\\u2029";
                 i += 2;
         }
@@ -78,6 +90,15 @@ static void dump(const std::string &value,std::string &out) {
     }
     out += '"';
 }
+static void dump(const std::vector<double> &value,std::string &out) {
+    out.reserve(out.size() + value.size() * 8 + 2);
+    out += "[";
+    for(size_t i = 0;i < value.size();i ++) {
+        if(i) out += ",";
+        dump(value[i],out);
+    }
+    out += "]";
+}
 static void dump(const Json::array &value,std::string &out) {
     bool first_flag = true;
     out += "[";
@@ -133,8 +154,8 @@ protected:
 class JsonDouble final : public Value<Json::Type::NUMBER,double> {
     double number_value() const override {return value_;}
     int int_value() const override {return static_cast<int>(value_);}
-    bool equals(const JsonValue *other) {return value_ == other->number_value();}
-    bool less(const JsonValue *other) {return value_ < other->number_value();}
+    bool equals(const JsonValue *other) const override {return value_ == other->number_value();}
+    bool less(const JsonValue *other) const override {return value_ < other->number_value();}
 public:
     explicit JsonDouble(double value):Value(value) {}
 };
@@ -142,8 +163,8 @@ public:
 class JsonInt final : public Value<Json::Type::NUMBER,int> {
     double number_value() const override {return value_;}
     int int_value() const override {return value_;}
-    bool equals(const JsonValue *other) {return value_ == other->number_value();}
-    bool less(const JsonValue *other) {return value_ < other->number_value();}
+    bool equals(const JsonValue *other) const override {return value_ == other->number_value();}
+    bool less(const JsonValue *other) const override {return value_ < other->number_value();}
 public:
     explicit JsonInt(int value):Value(value) {}
 };
@@ -164,11 +185,29 @@ public:
 class JsonArray final : public Value<Json::Type::ARRAY,Json::array> {
     const Json::array& array_items() const override {return value_;}
     const Json& operator[](size_t) const override;
+    // the other side may be a packed JsonNumberArray
+    bool equals(const JsonValue *other) const override {return value_ == other->array_items();}
+    bool less(const JsonValue *other) const override {return value_ < other->array_items();}
 public:
     explicit JsonArray(const Json::array &value):Value(value) {}
     explicit JsonArray(Json::array &&value):Value(std::move(value)) {}
 };
 
+// an array of numbers kept as one contiguous buffer. array_items() materializes
+// the Json elements on first use for callers that want the generic view.
+class JsonNumberArray final : public Value<Json::Type::ARRAY,std::vector<double>> {
+    Json::numbers number_span() const override {return {value_.data(),value_.size()};}
+    const Json::array& array_items() const override;
+    const Json& operator[](size_t) const override;
+    bool equals(const JsonValue *other) const override;
+    bool less(const JsonValue *other) const override;
+
+    mutable std::once_flag items_once_;
+    mutable Json::array items_;
+public:
+    explicit JsonNumberArray(std::vector<double> &&value):Value(std::move(value)) {}
+};
+
 class JsonObject final : public Value<Json::Type::OBJECT,Json::object> {
     const Json::object& object_items() const override {return value_;}
     const Json& operator[](const std::string&) const override;
@@ -182,6 +221,31 @@ public:
     JsonNUll():Value({}) {}
 };
 
+// a value together with its serialized text, rendered once when it is created.
+// values never change, so the text never goes stale.
+class JsonPrerendered final : public JsonValue {
+    Json::Type type() const override {return value_->type();}
+    bool equals(const JsonValue *other) const override {return value_->equals(other);}
+    bool less(const JsonValue *other) const override {return value_->less(other);}
+    void dump(std::string &out) const override {out += text_;}
+    const JsonValue* resolved() const override {return value_.get();}
+    double number_value() const override {return value_->number_value();}
+    int int_value() const override {return value_->int_value();}
+    bool bool_value() const override {return value_->bool_value();}
+    const std::string& string_value() const override {return value_->string_value();}
+    const Json::array& array_items() const override {return value_->array_items();}
+    const Json::object& object_items() const override {return value_->object_items();}
+    Json::numbers number_span() const override {return value_->number_span();}
+    const Json& operator[](size_t index) const override {return (*value_)[index];}
+    const Json& operator[](const std::string &key) const override {return (*value_)[key];}
+
+    const std::shared_ptr<JsonValue> value_;
+    const std::string text_;
+public:
+    JsonPrerendered(std::shared_ptr<JsonValue> value,std::string &&text)
+        :value_(std::move(value)),text_(std::move(text)) {}
+};
+
 // ***********************************
 //  * Statics
 //  * 
@@ -220,6 +284,19 @@ Json::Json(Json::array &&value)         :value_ptr_{std::make_shared<JsonArray>(
 Json::Json(const object &value)         :value_ptr_{std::make_shared<JsonObject>(value)} {}
 Json::Json(object &&value)              :value_ptr_{std::make_shared<JsonObject>(std::move(value))} {}
 
+Json Json::prerendered(const Json &value) {
+    if(value.value_ptr_->resolved() != value.value_ptr_.get()) return value;
+    Json json;
+    json.value_ptr_ = std::make_shared<JsonPrerendered>(value.value_ptr_,value.dump());
+    return json;
+}
+
+Json Json::number_array(std::vector<double> values) {
+    Json json;
+    json.value_ptr_ = std::make_shared<JsonNumberArray>(std::move(values));
+    return json;
+}
+
 // ***********************************
 //  * Accesstors
 //  *
@@ -230,6 +307,7 @@ bool                    Json::bool_value()                          const {retur
 const std::string&      Json::string_value()                        const {return value_ptr_->string_value();}
 const Json::array&      Json::array_items()                         const {return value_ptr_->array_items();}
 const Json::object&     Json::object_items()                        const {return value_ptr_->object_items();}
+Json::numbers           Json::number_span()                         const {return value_ptr_->number_span();}
 const Json&             Json::operator[](size_t index)              const {return (*value_ptr_)[index];}
 const Json&             Json::operator[](const std::string &key)    const {return (*value_ptr_)[key];}
 
@@ -239,6 +317,8 @@ bool                    JsonValue::bool_value()                     const {retur
 const std::string&      JsonValue::string_value()                   const {return statics().empty_string;}
 const Json::array&      JsonValue::array_items()                    const {return statics().empty_array;}
 const Json::object&     JsonValue::object_items()                   const {return statics().empty_object;}
+Json::numbers           JsonValue::number_span()                    const {return {nullptr,0};}
+const JsonValue*        JsonValue::resolved()                       const {return this;}
 const Json&             JsonValue::operator[](size_t)               const {return static_null();}
 const Json&             JsonValue::operator[](const std::string&)   const {return static_null();}
 
@@ -246,6 +326,47 @@ const Json& JsonArray::operator[](size_t index) const {
     if(index >= value_.size()) throw std::runtime_error("out index");
     return value_[index];
 }
+// the element a packed number turns back into. integral values in int range become
+// JsonInt again, as the parser would have built them (-0 stays a double so it dumps as -0).
+static Json number_json(double value) {
+    if(value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max()
+        && static_cast<int>(value) == value && !(value == 0 && std::signbit(value)))
+        return static_cast<int>(value);
+    return value;
+}
+
+const Json::array& JsonNumberArray::array_items() const {
+    std::call_once(items_once_,[this] {
+        items_.reserve(value_.size());
+        for(double value : value_) items_.push_back(number_json(value));
+    });
+    return items_;
+}
+const Json& JsonNumberArray::operator[](size_t index) const {
+    if(index >= value_.size()) throw std::runtime_error("out index");
+    return array_items()[index];
+}
+// the other side is compared element by element, a generic array is never built for this one
+bool JsonNumberArray::equals(const JsonValue *other) const {
+    const Json::numbers rhs = other->number_span();
+    if(rhs.data) return value_.size() == rhs.size && std::equal(value_.begin(),value_.end(),rhs.begin());
+    const Json::array &items = other->array_items();
+    if(value_.size() != items.size()) return false;
+    for(size_t i = 0;i < value_.size();i ++) {
+        if(items[i].type() != Json::NUMBER || items[i].number_value() != value_[i]) return false;
+    }
+    return true;
+}
+bool JsonNumberArray::less(const JsonValue *other) const {
+    const Json::numbers rhs = other->number_span();
+    if(rhs.data) return std::lexicographical_compare(value_.begin(),value_.end(),rhs.begin(),rhs.end());
+    const Json::array &items = other->array_items();
+    for(size_t i = 0;i < value_.size() && i < items.size();i ++) {
+        if(items[i].type() != Json::NUMBER) return Json::NUMBER < items[i].type();
+        if(value_[i] != items[i].number_value()) return value_[i] < items[i].number_value();
+    }
+    return value_.size() < items.size();
+}
 const Json& JsonObject::operator[](const std::string &key) const {
     auto iter = value_.find(key);
     return iter != value_.end() ? iter->second : static_null();
@@ -255,17 +376,114 @@ const Json& JsonObject::operator[](const std::string &key) const {
 //  * Comparetors
 //  *
 bool Json::operator==(const Json &rhs) const {
-    if(value_ptr_ == rhs.value_ptr_) return true;
+    const JsonValue *lhs_value = value_ptr_->resolved(), *rhs_value = rhs.value_ptr_->resolved();
+    if(lhs_value == rhs_value) return true;
     if(type() != rhs.type()) return false;
-    return value_ptr_->equals(rhs.value_ptr_.get());
+    return lhs_value->equals(rhs_value);
 }
 
 bool Json::operator<(const Json &rhs) const {
-    if(value_ptr_ == rhs.value_ptr_) return false;
-    if(type() < rhs.type()) return true;
-    return value_ptr_->less(rhs.value_ptr_.get());
+    const JsonValue *lhs_value = value_ptr_->resolved(), *rhs_value = rhs.value_ptr_->resolved();
+    if(lhs_value == rhs_value) return false;
+    if(type() != rhs.type()) return type() < rhs.type();
+    return lhs_value->less(rhs_value);
 }
 
+// ***********************************
+//  * Projection
+//  *
+struct JsonProjectionNode {
+    // the whole value at this node is wanted
+    bool terminal = false;
+    std::map<std::string,std::unique_ptr<JsonProjectionNode>> children;
+    std::unique_ptr<JsonProjectionNode> wildcard;
+    // the children whose token is an array index, so arrays are matched without formatting
+    std::map<size_t,const JsonProjectionNode*> indices;
+
+    // a named child already carries everything the wildcard asks for (see normalize),
+    // so a lookup never has to follow two branches.
+    const JsonProjectionNode* child(const std::string &key) const {
+        auto iter = children.find(key);
+        return iter != children.end() ? iter->second.get() : wildcard.get();
+    }
+    const JsonProjectionNode* child(size_t index) const {
+        if(indices.empty()) return wildcard.get();
+        auto iter = indices.find(index);
+        return iter != indices.end() ? iter->second : wildcard.get();
+    }
+
+    JsonProjectionNode* add(std::unique_ptr<JsonProjectionNode> &slot) {
+        if(!slot) slot.reset(new JsonProjectionNode);
+        return slot.get();
+    }
+    void merge(const JsonProjectionNode &other) {
+        terminal = terminal || other.terminal;
+        for(const auto &kv : other.children) {
+            add(children[kv.first])->merge(*kv.second);
+        }
+        if(other.wildcard) add(wildcard)->merge(*other.wildcard);
+    }
+    void normalize() {
+        if(wildcard) {
+            for(auto &kv : children) kv.second->merge(*wildcard);
+            wildcard->normalize();
+        }
+        for(auto &kv : children) {
+            kv.second->normalize();
+            size_t index;
+            if(array_index(kv.first,index)) indices[index] = kv.second.get();
+        }
+    }
+
+    // "0" or digits without a leading zero, as RFC 6901 spells an array index
+    static bool array_index(const std::string &token,size_t &index) {
+        if(token.empty() || token.size() > 18 || (token[0] == '0' && token.size() > 1)) return false;
+        index = 0;
+        for(char ch : token) {
+            if(ch < '0' || ch > '9') return false;
+            index = index * 10 + (ch - '0');
+        }
+        return true;
+    }
+};
+
+// split a JSON Pointer (RFC 6901) into its reference tokens, "~1" is '/' and "~0" is '~'.
+static std::vector<std::string> pointer_tokens(const std::string &path) {
+    std::vector<std::string> tokens;
+    if(path.empty()) return tokens;
+    if(path[0] != '/') throw std::invalid_argument("json pointer must start with '/': " + path);
+    for(size_t i = 1;i <= path.size();i ++) {
+        if(i == 1 || path[i - 1] == '/') tokens.emplace_back();
+        if(i == path.size()) break;
+        const char ch = path[i];
+        if(ch == '/') continue;
+        if(ch == '~' && i + 1 < path.size() && (path[i + 1] == '0' || path[i + 1] == '1')) {
+            tokens.back() += path[++ i] == '0' ? '~' : '/';
+            continue;
+        }
+        tokens.back() += ch;
+    }
+    return tokens;
+}
+
+static std::shared_ptr<const JsonProjectionNode> compile_projection(const std::vector<std::string> &paths) {
+    std::shared_ptr<JsonProjectionNode> root = std::make_shared<JsonProjectionNode>();
+    for(const auto &path : paths) {
+        JsonProjectionNode *node = root.get();
+        for(const auto &token : pointer_tokens(path)) {
+            node = node->add(token == "*" ? node->wildcard : node->children[token]);
+        }
+        node->terminal = true;
+    }
+    root->normalize();
+    return root;
+}
+
+JsonProjection::JsonProjection(std::initializer_list<std::string> paths)
+    :root_{compile_projection(std::vector<std::string>(paths))} {}
+JsonProjection::JsonProjection(const std::vector<std::string> &paths)
+    :root_{compile_projection(paths)} {}
+
 // ***********************************
 //  * Parse
 //  *
@@ -283,25 +501,240 @@ static inline std::string esc(char c) {
 constexpr static inline bool in_range(long x,long lower,long upper) {
     return (x >= lower && x <= upper);
 }
+
+// length of the well-formed UTF-8 sequence starting at in[pos] (Unicode Table 3-7),
+// 0 if it is malformed, overlong, a surrogate or past U+10FFFF.
+static size_t utf8_sequence_length(const std::string &in,size_t pos) {
+    const uint8_t lead = static_cast<uint8_t>(in[pos]);
+    size_t len;
+    uint8_t lower = 0x80, upper = 0xbf; // range of the second byte
+    if(in_range(lead,0xc2,0xdf))        len = 2;
+    else if(lead == 0xe0)               {len = 3; lower = 0xa0;}
+    else if(lead == 0xed)               {len = 3; upper = 0x9f;}
+    else if(in_range(lead,0xe1,0xef))   len = 3;
+    else if(lead == 0xf0)               {len = 4; lower = 0x90;}
+    else if(lead == 0xf4)               {len = 4; upper = 0x8f;}
+    else if(in_range(lead,0xf1,0xf3))   len = 4;
+    else return 0;
+    if(pos + len > in.size()) return 0;
+    if(!in_range(static_cast<uint8_t>(in[pos + 1]),lower,upper)) return 0;
+    for(size_t i = 2;i < len;i ++) {
+        if(!in_range(static_cast<uint8_t>(in[pos + i]),0x80,0xbf)) return 0;
+    }
+    return len;
+}
+
+#if defined(TINY_JSON_UTF8_KERNEL)
+static bool cpu_has_ssse3() {
+    static const bool has_ssse3 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3") != 0;
+    }();
+    return has_ssse3;
+}
+
+// lookup-table UTF-8 validation (Keiser & Lemire, "Validating UTF-8 In Less Than One
+// Instruction Per Byte"), 16 bytes at a time. returns how far from pos the string body
+// is plain, well-formed text: it stops before the first block holding '"', '\\', a
+// control character or an error, then backs up over a sequence the last accepted block
+// left incomplete, so the scalar path sees every remaining sequence whole.
+__attribute__((target("ssse3")))
+static size_t scan_utf8_blocks(const char *data,size_t pos,size_t end) {
+    enum : uint8_t {
+        TOO_SHORT = 1 << 0, TOO_LONG = 1 << 1, OVERLONG_3 = 1 << 2, TOO_LARGE = 1 << 3,
+        SURROGATE = 1 << 4, OVERLONG_2 = 1 << 5, TOO_LARGE_1000 = 1 << 6, OVERLONG_4 = 1 << 6,
+        TWO_CONTS = 1 << 7, CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS
+    };
+    // indexed by the high nibble of the previous byte
+    const __m128i byte_1_high = _mm_setr_epi8(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    // indexed by the low nibble of the previous byte
+    const __m128i byte_1_low = _mm_setr_epi8(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+        CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000);
+    // indexed by the high nibble of the current byte
+    const __m128i byte_2_high = _mm_setr_epi8(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i ctrl_max = _mm_set1_epi8(0x1f);
+    const __m128i zero = _mm_setzero_si128();
+
+    const size_t start_pos = pos;
+    __m128i prev_block = zero;
+    while(pos + 16 <= end) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        const __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block,quote),_mm_cmpeq_epi8(block,backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(block,ctrl_max),ctrl_max));
+        const __m128i prev1 = _mm_alignr_epi8(block,prev_block,15);
+        const __m128i special_cases = _mm_and_si128(
+            _mm_and_si128(
+                _mm_shuffle_epi8(byte_1_high,_mm_and_si128(_mm_srli_epi16(prev1,4),nibble)),
+                _mm_shuffle_epi8(byte_1_low,_mm_and_si128(prev1,nibble))),
+            _mm_shuffle_epi8(byte_2_high,_mm_and_si128(_mm_srli_epi16(block,4),nibble)));
+        // third and fourth bytes of a sequence must be continuations, which the tables don't see
+        const __m128i prev2 = _mm_alignr_epi8(block,prev_block,14);
+        const __m128i prev3 = _mm_alignr_epi8(block,prev_block,13);
+        const __m128i must_be_continuation = _mm_and_si128(_mm_or_si128(
+            _mm_subs_epu8(prev2,_mm_set1_epi8(static_cast<char>(0xe0 - 0x80))),
+            _mm_subs_epu8(prev3,_mm_set1_epi8(static_cast<char>(0xf0 - 0x80)))),
+            _mm_set1_epi8(static_cast<char>(0x80)));
+        const __m128i error = _mm_xor_si128(must_be_continuation,special_cases);
+        // one branch per block: stop at a special byte or at any nonzero error byte
+        if(_mm_movemask_epi8(_mm_andnot_si128(special,_mm_cmpeq_epi8(error,zero))) != 0xffff) break;
+        prev_block = block;
+        pos += 16;
+    }
+    if(pos > start_pos) {
+        if(static_cast<uint8_t>(data[pos - 1]) >= 0xc0) pos -= 1;
+        else if(static_cast<uint8_t>(data[pos - 2]) >= 0xe0) pos -= 2;
+        else if(static_cast<uint8_t>(data[pos - 3]) >= 0xf0) pos -= 3;
+    }
+    return pos;
+}
+#endif
+
+// buffers a parser reuses instead of growing fresh temporaries for every value.
+// the stacks are shared by all nesting levels, each container pops what it pushed.
+struct JsonParseScratch {
+    std::string text;               // decode buffer of the current string
+    Json::array values;             // elements of the arrays being parsed
+    std::vector<double> numbers;    // elements of the packed number arrays being parsed
+    Json::Parser::high_water peak {0,0,0};
+
+    void clear() {
+        text.clear();
+        values.clear();
+        numbers.clear();
+    }
+};
+
 namespace {
+// parse policies. every knob is a compile time constant, so a parser instantiated
+// for STANDARD carries no comment or leniency branches at all.
+struct StandardPolicy {
+    static constexpr bool comments = false;
+    static constexpr bool trailing_commas = false;
+    static constexpr size_t max_depth = MAX_DEPTH;
+    static constexpr bool strict_utf8 = false;
+};
+struct CommentsPolicy : StandardPolicy {
+    static constexpr bool comments = true;
+};
+// config files: comments and a trailing ',' before '}' or ']'
+struct LenientPolicy : CommentsPolicy {
+    static constexpr bool trailing_commas = true;
+};
+// untrusted input: every string must be well-formed UTF-8, on top of any other policy
+template<class Base>
+struct StrictUtf8 : Base {
+    static constexpr bool strict_utf8 = true;
+};
+
+// rough memory cost of what the parser builds, charged against JsonLimits::max_alloc_bytes
+static constexpr size_t NODE_BYTES = sizeof(Json) + 64; // a Json handle and its make_shared block
+static constexpr size_t MEMBER_BYTES = sizeof(Json::object::value_type) + 32; // a std::map node
+
+// 0 in JsonLimits means no limit, turn it into a bound the parser can compare against
+static JsonLimits effective_limits(JsonLimits limits) {
+    const size_t none = std::numeric_limits<size_t>::max();
+    if(!limits.max_bytes) limits.max_bytes = none;
+    if(!limits.max_nodes) limits.max_nodes = none;
+    if(!limits.max_string_bytes) limits.max_string_bytes = none;
+    if(!limits.max_members) limits.max_members = none;
+    if(!limits.max_alloc_bytes) limits.max_alloc_bytes = none;
+    return limits;
+}
+
 // parser
+template<class Policy>
 struct JsonParser final {
     const std::string &str;
     std::string &err;
     size_t cur;
     bool failed;
-    const JsonParse strategy;
+    const JsonLimits limits;
+    size_t nodes;
+    size_t alloc_bytes;
+    JsonParseScratch &scratch;
 
     Json fail(const std::string &msg) {
         return fail(msg,Json());
     }
+    // only the first error is kept, with the offset it was found at
     template<class T>
     T fail(const std::string &msg,const T ret) {
+        if(!failed) err = msg + " at offset " + std::to_string(cur);
         failed = true;
-        if(!failed) err = std::move(msg);
         return ret;
     }
 
+    // charge new values and their approximate memory against the budgets
+    bool charge(size_t new_nodes,size_t bytes) {
+        nodes += new_nodes;
+        if(nodes > limits.max_nodes)
+            return fail("exceeded max_nodes (" + std::to_string(limits.max_nodes) + ")",false);
+        alloc_bytes += bytes;
+        if(alloc_bytes > limits.max_alloc_bytes)
+            return fail("exceeded max_alloc_bytes (" + std::to_string(limits.max_alloc_bytes) + ")",false);
+        return true;
+    }
+    bool check_members(size_t count) {
+        if(count >= limits.max_members)
+            return fail("exceeded max_members (" + std::to_string(limits.max_members) + ")",false);
+        return true;
+    }
+    // move the values staged above base into a container of their own
+    Json::array pop_values(size_t base) {
+        auto &values = scratch.values;
+        scratch.peak.values = std::max(scratch.peak.values,values.size());
+        Json::array data(std::make_move_iterator(values.begin() + base),std::make_move_iterator(values.end()));
+        values.erase(values.begin() + base,values.end());
+        return data;
+    }
+    std::vector<double> pop_numbers(size_t base) {
+        auto &numbers = scratch.numbers;
+        scratch.peak.numbers = std::max(scratch.peak.numbers,numbers.size());
+        std::vector<double> data(numbers.begin() + base,numbers.end());
+        numbers.erase(numbers.begin() + base,numbers.end());
+        return data;
+    }
+
+    // move the numbers staged above base onto the values stack as Json elements
+    void unpack_numbers(size_t base) {
+        auto &numbers = scratch.numbers;
+        scratch.peak.numbers = std::max(scratch.peak.numbers,numbers.size());
+        for(size_t i = base;i < numbers.size();i ++) scratch.values.push_back(number_json(numbers[i]));
+        numbers.erase(numbers.begin() + base,numbers.end());
+    }
+
+    // bytes a string may still grow by before it breaks max_string_bytes or max_alloc_bytes
+    size_t string_room(const std::string &out) const {
+        return std::min(limits.max_string_bytes - out.size(),limits.max_alloc_bytes - alloc_bytes);
+    }
+    bool check_string(const std::string &out) {
+        if(out.size() > limits.max_string_bytes)
+            return fail("exceeded max_string_bytes (" + std::to_string(limits.max_string_bytes) + ")",false);
+        if(out.size() > limits.max_alloc_bytes - alloc_bytes)
+            return fail("exceeded max_alloc_bytes (" + std::to_string(limits.max_alloc_bytes) + ")",false);
+        return true;
+    }
+
     void consume_whitespace() {
         while(str[cur] == ' ' 
             || str[cur] == '\r' 
@@ -341,7 +774,7 @@ struct JsonParser final {
 
     void consume_garbage() {
         consume_whitespace();
-        if(strategy == JsonParse::COMMENTS) {
+        if(Policy::comments) {
             bool comment_founed = false;
             do {
                 comment_founed = consume_comment();
@@ -379,30 +812,91 @@ struct JsonParser final {
         }
     }
 
+    // emit a pending \u escape. strict mode rejects an unpaired surrogate.
+    bool flush_codepoint(long &pt,std::string &out) {
+        if(Policy::strict_utf8 && in_range(pt,0xD800,0xDFFF))
+            return fail("unpaired surrogate in \\u escape",false);
+        encode_utf8(pt,out);
+        pt = -1;
+        return true;
+    }
+
+    static bool is_special(char ch) {
+        return ch == '"' || ch == '\\' || static_cast<uint8_t>(ch) < 0x20
+            || (Policy::strict_utf8 && static_cast<uint8_t>(ch) >= 0x80);
+    }
+
+    // return the first position in [pos, end) that the string scanner has to look at, or end:
+    // '"', '\\', a control character and, in strict mode, any non-ASCII byte that is not
+    // already validated by the SSSE3 kernel.
+    size_t scan_plain(size_t pos,size_t end) const {
+#if defined(TINY_JSON_UTF8_KERNEL)
+        if(Policy::strict_utf8 && cpu_has_ssse3()) {
+            pos = scan_utf8_blocks(str.data(),pos,end);
+            while(pos < end && !is_special(str[pos])) pos ++;
+            return pos;
+        }
+#endif
+#if defined(__SSE2__)
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i space = _mm_set1_epi8(0x20);
+        const __m128i ctrl_max = _mm_set1_epi8(0x1f);
+        while(pos + 16 <= end) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + pos));
+            __m128i special = _mm_or_si128(_mm_cmpeq_epi8(block,quote),_mm_cmpeq_epi8(block,backslash));
+            if(Policy::strict_utf8) // signed compare, catches control characters and bytes >= 0x80
+                special = _mm_or_si128(special,_mm_cmplt_epi8(block,space));
+            else
+                special = _mm_or_si128(special,_mm_cmpeq_epi8(_mm_max_epu8(block,ctrl_max),ctrl_max));
+            const int mask = _mm_movemask_epi8(special);
+            if(mask) return pos + __builtin_ctz(mask);
+            pos += 16;
+        }
+#endif
+        while(pos < end && !is_special(str[pos])) pos ++;
+        return pos;
+    }
+
     // parse string
     std::string parse_string() {
-        std::string out;
+        std::string &out = scratch.text;
+        out.clear();
         long last_escaped_codepoint = -1;
         while(true) {
+            if(!check_string(out)) return {};
+            // never scan or copy more than one byte past either budget
+            const size_t room = string_room(out);
+            const size_t run_end = scan_plain(cur,room < str.size() - cur ? cur + room + 1 : str.size());
+            if(run_end != cur) {
+                if(!flush_codepoint(last_escaped_codepoint,out)) return {};
+                out.append(str,cur,run_end - cur);
+                cur = run_end;
+            }
+            if(!check_string(out)) return {};
             if(cur >= str.size()) return fail("out of the str range",std::string{});
-            auto ch = get_next_token();
+            auto ch = str[cur ++];
             if(ch == '"') {
-                encode_utf8(last_escaped_codepoint,out);
+                if(!flush_codepoint(last_escaped_codepoint,out)) return {};
+                if(!check_string(out) || !charge(0,out.size())) return {};
+                scratch.peak.string_bytes = std::max(scratch.peak.string_bytes,out.size());
                 return out;
             }
             if(in_range(ch,0x0,0x1f)) {
                 return fail("the character is not unescaped",std::string{});
             }
-            if(ch != '\\') {
-                encode_utf8(last_escaped_codepoint,out);
-                last_escaped_codepoint = -1;
-                out += ch;
+            if(ch != '\\') { // only reached in strict mode, the lead byte of a multibyte sequence
+                const size_t len = utf8_sequence_length(str,cur - 1);
+                if(!len) return fail("invalid UTF-8 sequence",std::string{});
+                if(!flush_codepoint(last_escaped_codepoint,out)) return {};
+                out.append(str,cur - 1,len);
+                cur += len - 1;
                 continue;
             }
 
             if(cur >= str.size()) return fail("out of the str range",std::string{});
             
-            ch = get_next_token();
+            ch = str[cur ++];
             if(ch == 'u') {
                 auto esp = str.substr(cur,4);
                 if(esp.size() < 4) return fail("bad escape" + esp,std::string{});
@@ -417,19 +911,18 @@ struct JsonParser final {
                 // "blah\ud83d\udca9blah\ud83dblah\udca9blah\u0000blah\u1234"
                 if(in_range(last_escaped_codepoint,0xD800,0xDBFF)
                     && in_range(codepoint,0xDC00,0xDFFF)) {
-                    encode_utf8(((last_escaped_codepoint - 0xD800) << 10)
-                        | (codepoint - 0xDC00) + 0x10000,out);
+                    encode_utf8((((last_escaped_codepoint - 0xD800) << 10)
+                        | (codepoint - 0xDC00)) + 0x10000,out);
                     last_escaped_codepoint = -1;    
                 }
                 else {
-                    encode_utf8(last_escaped_codepoint,out);
+                    if(!flush_codepoint(last_escaped_codepoint,out)) return {};
                     last_escaped_codepoint = codepoint;
                 }
                 cur += 4;
                 continue;
             }
-            encode_utf8(last_escaped_codepoint, out);
-            last_escaped_codepoint = -1;
+            if(!flush_codepoint(last_escaped_codepoint,out)) return {};
 
             if(ch == 'b') {
                 out += '\b';
@@ -454,7 +947,8 @@ struct JsonParser final {
             }
         }
     }
-    Json parse_number() {
+    // scan a number and return its value, is_int is set when it takes the int path
+    double scan_number(bool &is_int) {
         size_t start_pos = cur;
 
         if (str[cur] == '-')
@@ -464,17 +958,18 @@ struct JsonParser final {
         if (str[cur] == '0') {
             cur++;
             if (in_range(str[cur], '0', '9'))
-                return fail("leading 0s not permitted in numbers");
+                return fail("leading 0s not permitted in numbers",0.0);
         } else if (in_range(str[cur], '1', '9')) {
             cur++;
             while (in_range(str[cur], '0', '9'))
                 cur++;
         } else {
-            return fail("invalid " + esc(str[cur]) + " in number");
+            return fail("invalid " + esc(str[cur]) + " in number",0.0);
         }
 
         if (str[cur] != '.' && str[cur] != 'e' && str[cur] != 'E'
                 && (cur - start_pos) <= static_cast<size_t>(std::numeric_limits<int>::digits10)) {
+            is_int = true;
             return std::atoi(str.c_str() + start_pos);
         }
 
@@ -482,7 +977,7 @@ struct JsonParser final {
         if (str[cur] == '.') {
             cur++;
             if (!in_range(str[cur], '0', '9'))
-                return fail("at least one digit required in fractional part");
+                return fail("at least one digit required in fractional part",0.0);
 
             while (in_range(str[cur], '0', '9'))
                 cur++;
@@ -496,7 +991,7 @@ struct JsonParser final {
                 cur++;
 
             if (!in_range(str[cur], '0', '9'))
-                return fail("at least one digit required in exponent");
+                return fail("at least one digit required in exponent",0.0);
 
             while (in_range(str[cur], '0', '9'))
                 cur++;
@@ -505,27 +1000,49 @@ struct JsonParser final {
         return std::strtod(str.c_str() + start_pos, nullptr);
     }
 
+    Json parse_number() {
+        bool is_int = false;
+        const double value = scan_number(is_int);
+        if (failed)
+            return Json();
+        if (is_int)
+            return static_cast<int>(value);
+        return value;
+    }
+
     // expect
     Json expect(const std::string &expected,const Json &res) {
         cur --;
         if(str.compare(cur,expected.length(),expected) == 0) {
             cur += expected.length();
-            return expected;
+            return res;
         }
         return fail("parse error: expected " + expected + ", got " + str.substr(cur, expected.length())); 
     }
 
-    // parse json
+    // parse json. with a projection node only what the node asks for is built and
+    // everything else is skipped, nullptr (or a terminal node) builds the whole value.
 
-    Json parse_json(int depth) {
-        if (depth > MAX_DEPTH) {
+    Json parse_json(size_t depth,const JsonProjectionNode *node = nullptr) {
+        if (node && node->terminal)
+            node = nullptr;
+        if (depth > Policy::max_depth) {
             return fail("exceeded maximum nesting depth");
         }
+        if (!charge(1,NODE_BYTES))
+            return Json();
 
         char ch = get_next_token();
         if (failed)
             return Json();
 
+        // a scalar where the path expects a container
+        if (node && ch != '{' && ch != '[') {
+            cur --;
+            skip_value(depth);
+            return Json();
+        }
+
         if (ch == '-' || in_range(ch,'0','9')) {
             cur --;
             return parse_number();
@@ -561,7 +1078,15 @@ struct JsonParser final {
                 if (ch != ':')
                     return fail("expected ':' in object, got " + esc(ch));
 
-                data[std::move(key)] = parse_json(depth + 1);
+                const JsonProjectionNode *child = node ? node->child(key) : nullptr;
+                if (node && !wanted(child)) {
+                    skip_value(depth + 1);
+                }
+                else {
+                    if (!check_members(data.size()) || !charge(0,MEMBER_BYTES))
+                        return Json();
+                    data[std::move(key)] = parse_json(depth + 1, child);
+                }
                 if (failed)
                     return Json();
 
@@ -572,23 +1097,56 @@ struct JsonParser final {
                     return fail("expected ',' in object, got " + esc(ch));
 
                 ch = get_next_token();
+                if (Policy::trailing_commas && ch == '}')
+                    break;
             }
             return data;
         }
 
         if (ch == '[') {
-            Json::array data;
             ch = get_next_token();
             if (ch == ']')
-                return data;
+                return Json::array();
 
+            // elements are staged on the scratch stacks, numbers packed until the first
+            // element that is not a number or is left out by the projection
+            const size_t values_base = scratch.values.size();
+            const size_t numbers_base = scratch.numbers.size();
+            bool packed = true;
             while (1) {
                 cur --;
-                data.push_back(parse_json(depth + 1));
-                if (failed) {
-                    std::cout << err;
+                const size_t index = packed ? scratch.numbers.size() - numbers_base
+                    : scratch.values.size() - values_base;
+                if (!check_members(index))
                     return Json();
+                const JsonProjectionNode *child = node ? node->child(index) : nullptr;
+                const bool want = !node || wanted(child);
+                if (packed && want && (ch == '-' || in_range(ch,'0','9'))) {
+                    if (!charge(1,sizeof(double)))
+                        return Json();
+                    bool is_int = false;
+                    scratch.numbers.push_back(scan_number(is_int));
+                }
+                else {
+                    if (packed) {
+                        if (!charge(0,(scratch.numbers.size() - numbers_base) * NODE_BYTES))
+                            return Json();
+                        unpack_numbers(numbers_base);
+                        packed = false;
+                    }
+                    if (want) {
+                        Json value = parse_json(depth + 1, child);
+                        scratch.values.push_back(std::move(value));
+                    }
+                    else {
+                        skip_value(depth + 1);
+                        if (!charge(0,sizeof(Json)))
+                            return Json();
+                        scratch.values.push_back(Json());
+                    }
                 }
+                if (failed)
+                    return Json();
 
                 ch = get_next_token();
                 if (ch == ']') {
@@ -599,33 +1157,185 @@ struct JsonParser final {
                     return fail("expected ',' in list, got " + esc(ch));
 
                 ch = get_next_token();
-                (void)ch;
+                if (Policy::trailing_commas && ch == ']')
+                    break;
             }
-            return data;
+            if (packed)
+                return Json::number_array(pop_numbers(numbers_base));
+            return pop_values(values_base);
         }
 
         return fail("expected value, got " + esc(ch));
     }
-};
-} // namespace
 
-Json Json::parse(const std::string &in,std::string &err,JsonParse strategy) {
-    JsonParser parser {in,err,0,false,strategy};
-    try {
-        auto result = parser.parse_json(0);
-        parser.consume_garbage();
-        if(parser.failed) {
-            std::cout << result.value_ptr_->string_value();
-            return Json{};
+    // skip over one value at the given depth without building it. quotes and brackets
+    // are matched, scalars and the placement of ',' and ':' are not validated.
+    void skip_value(size_t depth) {
+        consume_garbage();
+        if(failed) return;
+        if(cur >= str.size()) { fail("out of the str range"); return; }
+        const char first = str[cur];
+        if(first != '"' && first != '[' && first != '{') {
+            const size_t start_pos = cur;
+            while(cur < str.size() && str[cur] != ',' && str[cur] != ']' && str[cur] != '}'
+                && str[cur] != ' ' && str[cur] != '\r' && str[cur] != '\n' && str[cur] != '\t'
+                && str[cur] != '/') cur ++;
+            if(cur == start_pos) fail("expected value, got " + esc(first));
+            return;
         }
-        if(parser.cur != in.size()) {
-            return parser.fail("unexpected trailing " + esc(in[parser.cur]));
+        // one bit per open container, set for '{', so every closer can be matched
+        // against its opener without allocating
+        uint64_t open_objects[Policy::max_depth / 64 + 1];
+        size_t nesting = 0;
+        do {
+            if(cur >= str.size()) { fail("out of the str range"); return; }
+            const char ch = str[cur ++];
+            if(ch == '"') {
+                while(cur < str.size() && str[cur] != '"') {
+                    if(Policy::strict_utf8 && static_cast<uint8_t>(str[cur]) >= 0x80) {
+                        const size_t len = utf8_sequence_length(str,cur);
+                        if(!len) { fail("invalid UTF-8 sequence"); return; }
+                        cur += len;
+                        continue;
+                    }
+                    cur += str[cur] == '\\' ? 2 : 1;
+                }
+                if(cur >= str.size()) { fail("out of the str range"); return; }
+                cur ++;
+            }
+            else if(ch == '[' || ch == '{') {
+                if(depth + nesting > Policy::max_depth) { fail("exceeded maximum nesting depth"); return; }
+                const uint64_t bit = uint64_t(1) << (nesting % 64);
+                if(ch == '{') open_objects[nesting / 64] |= bit;
+                else open_objects[nesting / 64] &= ~bit;
+                nesting ++;
+            }
+            else if(ch == ']' || ch == '}') {
+                if(nesting == 0) { fail("unexpected " + esc(ch)); return; }
+                nesting --;
+                const bool is_object = open_objects[nesting / 64] & (uint64_t(1) << (nesting % 64));
+                if(is_object != (ch == '}')) { fail("mismatched " + esc(ch)); return; }
+            }
+            else if(Policy::comments && ch == '/') {
+                cur --;
+                consume_comment();
+                if(failed) return;
+            }
+        } while(nesting > 0);
+    }
+
+    // a scalar is only wanted if the path ends on it, otherwise a container must follow
+    bool wanted(const JsonProjectionNode *node) {
+        if(!node) return false;
+        if(node->terminal) return true;
+        consume_garbage();
+        return cur < str.size() && (str[cur] == '{' || str[cur] == '[');
+    }
+
+    // check that only garbage follows the top level value
+    Json finish(Json result) {
+        consume_garbage();
+        if(failed) return Json();
+        if(cur != str.size()) {
+            return fail("unexpected trailing " + esc(str[cur]));
         }
         return result;
     }
-    catch(std::exception e) {
-        std::cout << e.what();
+};
+
+template<class Policy>
+Json parse_with(const std::string &in,std::string &err,const JsonProjectionNode *projection,
+    const JsonLimits &limits,JsonParseScratch &scratch) {
+    JsonParser<Policy> parser {in,err,0,false,effective_limits(limits),0,0,scratch};
+    if(in.size() > parser.limits.max_bytes) {
+        return parser.fail("input of " + std::to_string(in.size()) + " bytes exceeded max_bytes ("
+            + std::to_string(parser.limits.max_bytes) + ")");
+    }
+    Json result;
+    scratch.clear();
+    try {
+        result = parser.finish(parser.parse_json(0,projection));
+    }
+    catch(const std::exception &e) {
+        result = parser.fail(e.what());
+    }
+    // a failed parse leaves values staged, drop them but keep the capacity
+    scratch.clear();
+    return result;
+}
+
+// the runtime strategy picks one of the prebuilt instantiations
+Json dispatch_parse(const std::string &in,std::string &err,const JsonProjectionNode *projection,
+    const JsonLimits &limits,JsonParse strategy,JsonParseScratch &scratch) {
+    switch(strategy) {
+    case JsonParse::COMMENTS:   return parse_with<CommentsPolicy>(in,err,projection,limits,scratch);
+    case JsonParse::LENIENT:    return parse_with<LenientPolicy>(in,err,projection,limits,scratch);
+    case JsonParse::STRICT_UTF8:
+        return parse_with<StrictUtf8<StandardPolicy>>(in,err,projection,limits,scratch);
+    case JsonParse::COMMENTS_STRICT_UTF8:
+        return parse_with<StrictUtf8<CommentsPolicy>>(in,err,projection,limits,scratch);
+    case JsonParse::LENIENT_STRICT_UTF8:
+        return parse_with<StrictUtf8<LenientPolicy>>(in,err,projection,limits,scratch);
+    default:                    return parse_with<StandardPolicy>(in,err,projection,limits,scratch);
     }
-    return {};
+}
+} // namespace
+
+Json Json::parse(const std::string &in,std::string &err,JsonParse strategy) {
+    JsonParseScratch scratch;
+    return dispatch_parse(in,err,nullptr,JsonLimits(),strategy,scratch);
+}
+
+Json Json::parse(const std::string &in,std::string &err,const JsonLimits &limits,JsonParse strategy) {
+    JsonParseScratch scratch;
+    return dispatch_parse(in,err,nullptr,limits,strategy,scratch);
+}
+
+Json Json::parse(const std::string &in,std::string &err,const JsonProjection &projection,JsonParse strategy) {
+    JsonParseScratch scratch;
+    return dispatch_parse(in,err,projection.root_.get(),JsonLimits(),strategy,scratch);
+}
+
+Json Json::parse(const std::string &in,std::string &err,const JsonProjection &projection,
+    const JsonLimits &limits,JsonParse strategy) {
+    JsonParseScratch scratch;
+    return dispatch_parse(in,err,projection.root_.get(),limits,strategy,scratch);
+}
+
+// ***********************************
+//  * Reusable parser
+//  *
+Json::Parser::Parser(JsonParse strategy)
+    :strategy_{strategy},scratch_{new JsonParseScratch} {}
+Json::Parser::~Parser() = default;
+Json::Parser::Parser(Parser&&) noexcept = default;
+Json::Parser& Json::Parser::operator=(Parser&&) noexcept = default;
+
+// a moved-from parser gets a fresh scratch the next time it is used
+JsonParseScratch& Json::Parser::scratch() {
+    if(!scratch_) scratch_.reset(new JsonParseScratch);
+    return *scratch_;
+}
+
+Json Json::Parser::parse(const std::string &in,std::string &err) {
+    return dispatch_parse(in,err,nullptr,JsonLimits(),strategy_,scratch());
+}
+Json Json::Parser::parse(const std::string &in,std::string &err,const JsonLimits &limits) {
+    return dispatch_parse(in,err,nullptr,limits,strategy_,scratch());
+}
+Json Json::Parser::parse(const std::string &in,std::string &err,const JsonProjection &projection) {
+    return dispatch_parse(in,err,projection.root_.get(),JsonLimits(),strategy_,scratch());
+}
+Json Json::Parser::parse(const std::string &in,std::string &err,const JsonProjection &projection,
+    const JsonLimits &limits) {
+    return dispatch_parse(in,err,projection.root_.get(),limits,strategy_,scratch());
+}
+
+void Json::Parser::reset() {
+    scratch_.reset(new JsonParseScratch);
+}
+
+Json::Parser::high_water Json::Parser::high_water_marks() const {
+    return scratch_ ? scratch_->peak : high_water{0,0,0};
 }
 }
\ No newline at end of file
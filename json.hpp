@@ -8,11 +8,41 @@
 #include <iostream>
 namespace tiny_json {
 
+// COMMENTS allows // and /* */ comments, LENIENT additionally allows trailing commas,
+// STRICT_UTF8 rejects strings that are not well-formed UTF-8 (for untrusted input),
+// the *_STRICT_UTF8 values combine it with COMMENTS or LENIENT.
+// strings are validated 16 bytes at a time on x86 CPUs with SSSE3 (detected at runtime),
+// a byte at a time otherwise.
 enum JsonParse {
-    STANDARD, COMMENTS
+    STANDARD, COMMENTS, LENIENT, STRICT_UTF8, COMMENTS_STRICT_UTF8, LENIENT_STRICT_UTF8
 };
 
 class JsonValue;
+class Json;
+struct JsonProjectionNode;
+struct JsonParseScratch;
+
+// a set of JSON Pointer paths compiled into a trie once and reused across parses.
+// "*" matches every member of an object or every element of an array,
+// e.g. {"/user/id", "/items/*/price"}.
+class JsonProjection final {
+public:
+    JsonProjection(std::initializer_list<std::string> paths);
+    explicit JsonProjection(const std::vector<std::string> &paths);
+private:
+    friend class Json;
+    std::shared_ptr<const JsonProjectionNode> root_;
+};
+
+// resource budgets for parsing untrusted input. 0 means no limit.
+// the parse fails as soon as one is exceeded, err tells which one and the byte offset.
+struct JsonLimits {
+    size_t max_bytes = 0;           // size of the whole input
+    size_t max_nodes = 0;           // values built, every element of a packed number array counts
+    size_t max_string_bytes = 0;    // decoded length of one string or object key
+    size_t max_members = 0;         // elements of one array or members of one object
+    size_t max_alloc_bytes = 0;     // estimate of the memory held by the result
+};
 
 class Json final {
 public:
@@ -21,6 +51,13 @@ public:
     };
     using array = std::vector<Json>;
     using object = std::map<std::string,Json>;
+    // contiguous view of a packed number array
+    struct numbers {
+        const double *data;
+        size_t size;
+        const double* begin() const {return data;}
+        const double* end() const {return data + size;}
+    };
     Json() noexcept;
     Json(std::nullptr_t) noexcept;
     Json(double);
@@ -47,6 +84,15 @@ public:
         ,int>::type = 0>
     Json(T &t):Json(object{t.begin(),t.end()}) {}
     Json(void*) = delete;
+    // an array of numbers stored as one packed buffer instead of one node per element.
+    // the parser produces these for arrays that hold only numbers.
+    // the first array_items() or operator[] builds the whole Json::array once and keeps
+    // it beside the buffer, so prefer number_span() for large arrays. elements come back
+    // as ints when their value is integral and fits.
+    static Json number_array(std::vector<double> values);
+    // the same value with its serialized text rendered once up front. dumping it, or any
+    // value that contains it, appends the cached text instead of walking the subtree again.
+    static Json prerendered(const Json &value);
     
     Type type() const;
     bool is_null() {return type() == NUL;}
@@ -62,6 +108,9 @@ public:
     const std::string& string_value() const;
     const array& array_items() const;
     const object& object_items() const;
+    // the packed buffer of a number array, {nullptr,0} for any other value,
+    // including an array of numbers built as a Json::array
+    numbers number_span() const;
     const Json& operator[](size_t) const;
     const Json& operator[](const std::string&) const;
     
@@ -88,7 +137,65 @@ public:
             err = "null input";
             return nullptr;
         }
+
+    // parse with resource budgets, see JsonLimits
+    static Json parse(
+        const std::string &in,
+        std::string &err,
+        const JsonLimits &limits,
+        JsonParse strategy = JsonParse::STANDARD);
+
+    // parse only the values reached by the projection's paths, every other subtree
+    // is skipped without being built. unmatched object members are left out,
+    // unmatched array elements become null so the indices of matched ones hold.
+    // skipped subtrees only have their strings and brackets checked, so malformed
+    // scalars or misplaced ',' and ':' inside them are not reported.
+    static Json parse(
+        const std::string &in,
+        std::string &err,
+        const JsonProjection &projection,
+        JsonParse strategy = JsonParse::STANDARD);
+    static Json parse(
+        const std::string &in,
+        std::string &err,
+        const JsonProjection &projection,
+        const JsonLimits &limits,
+        JsonParse strategy = JsonParse::STANDARD);
     
+    // a long-lived parser that keeps its scratch buffers (string decode buffer, element
+    // staging stacks) between calls, so a loop over similar documents stops allocating
+    // them. not thread safe, use one per thread. a moved-from parser stays usable and
+    // starts over with empty buffers.
+    class Parser final {
+    public:
+        // largest sizes the scratch buffers have been used at since construction or reset()
+        struct high_water {
+            size_t string_bytes;    // longest decoded string
+            size_t values;          // array elements staged at once
+            size_t numbers;         // packed numbers staged at once
+        };
+
+        explicit Parser(JsonParse strategy = JsonParse::STANDARD);
+        ~Parser();
+        Parser(Parser&&) noexcept;
+        Parser& operator=(Parser&&) noexcept;
+
+        Json parse(const std::string &in,std::string &err);
+        Json parse(const std::string &in,std::string &err,const JsonLimits &limits);
+        Json parse(const std::string &in,std::string &err,const JsonProjection &projection);
+        Json parse(const std::string &in,std::string &err,const JsonProjection &projection,
+            const JsonLimits &limits);
+
+        // give the retained buffers back, e.g. after an unusually large document
+        void reset();
+        high_water high_water_marks() const;
+    private:
+        JsonParseScratch& scratch();
+
+        JsonParse strategy_;
+        std::unique_ptr<JsonParseScratch> scratch_;
+    };
+
     // // parse multiple objects,concatenated or sparated by whitespace
     // static std::vector<Json> parse_multi(
     //     const std::string &in,
@@ -122,6 +229,9 @@ protected:
     friend class Json;
     friend class JsonInt;
     friend class JsonDouble;
+    friend class JsonArray;
+    friend class JsonNumberArray;
+    friend class JsonPrerendered;
 
     virtual Json::Type type() const = 0;
     virtual bool equals(const JsonValue*) const = 0;
@@ -133,6 +243,9 @@ protected:
     virtual const std::string& string_value() const;
     virtual const Json::array& array_items() const;
     virtual const Json::object& object_items() const;
+    virtual Json::numbers number_span() const;
+    // the value a wrapper such as JsonPrerendered stands for, the value itself otherwise
+    virtual const JsonValue* resolved() const;
     // operator[] for array
     virtual const Json& operator[](size_t) const;
     // operator[] for object 
@@ -36,6 +36,142 @@ int main() {
         });
         std::cout << obj.dump() << "\n";
     }
-    
+    {   // projection: pointer escaping, wildcard merging, index matching, skipping
+        std::string in = "{\"user\":{\"id\":7,\"tags\":[1,[2,{\"z\":\"]}\"}]]},"
+            "\"items\":[{\"price\":1,\"q\":2},{\"q\":3},{\"price\":2,\"q\":4}],\"a/b\":\"x\",\"m~n\":1}";
+        tiny_json::JsonProjection projection{"/user/id","/items/*/price","/items/1/q","/a~1b","/m~0n"};
+        auto res = tiny_json::Json::parse(in,err,projection);
+        assert(err.empty());
+        assert(res.dump() == "{\"a/b\":\"x\",\"items\":[{\"price\":1},{\"q\":3},{\"price\":2}],"
+            "\"m~n\":1,\"user\":{\"id\":7}}");
+        assert(tiny_json::Json::parse(in,err,tiny_json::JsonProjection{"/items/1"}).dump()
+            == "{\"items\":[null,{\"q\":3},null]}");
+        assert(tiny_json::Json::parse("{\"b\":[1,2}, \"a\":1}",err,tiny_json::JsonProjection{"/a"}).is_null());
+        assert(!err.empty());
+        err.clear();
+        std::cout << res.dump() << "\n";
+    }
+    {   // strategies: comments and trailing commas only where the policy allows them
+        using tiny_json::Json;
+        assert(Json::parse("[true,false,null]",err) == Json(Json::array{true,false,nullptr}));
+        assert(Json::parse("[1,2,]",err).is_null());
+        err.clear();
+        assert(Json::parse("/* c */ [1] // c",err).is_null());
+        err.clear();
+        assert(Json::parse("/* c */ [1] // c",err,tiny_json::JsonParse::COMMENTS).dump() == "[1]");
+        assert(Json::parse("[1,2,]",err,tiny_json::JsonParse::COMMENTS).is_null());
+        err.clear();
+        assert(Json::parse("{\"a\":[1,],} // c",err,tiny_json::JsonParse::LENIENT).dump() == "{\"a\":[1]}");
+        assert(Json::parse("\"a // b\"",err,tiny_json::JsonParse::COMMENTS).string_value() == "a // b");
+        std::string deep(300,'[');
+        assert(Json::parse(deep + std::string(300,']'),err).is_null());
+        err.clear();
+    }
+    {   // strict UTF-8: the edges of Unicode Table 3-7, at every offset around a 16-byte block
+        using tiny_json::Json;
+        const std::pair<const char*,bool> cases[] = {
+            {"\xc2\x80",true}, {"\xc1\xbf",false}, {"\xdf\xbf",true},
+            {"\xe0\xa0\x80",true}, {"\xe0\x9f\xbf",false},
+            {"\xed\x9f\xbf",true}, {"\xed\xa0\x80",false},
+            {"\xf0\x90\x80\x80",true}, {"\xf0\x8f\xbf\xbf",false},
+            {"\xf4\x8f\xbf\xbf",true}, {"\xf4\x90\x80\x80",false}, {"\xf5\x80\x80\x80",false},
+            {"\x80",false}, {"\xe4\xb8",false}, {"\xf0\x9f\x92",false},
+            {"\\ud83d\\udca9",true}, {"\\ud83d",false}, {"\\udca9",false},
+        };
+        for(const auto &c : cases) {
+            for(size_t offset = 0;offset < 40;offset ++) {
+                std::string text = "\"" + std::string(offset,'a') + c.first + "\xe4\xb8\xad text \xe4\xb8\xad text\"";
+                auto res = Json::parse(text,err,tiny_json::JsonParse::STRICT_UTF8);
+                assert(res.is_string() == c.second && err.empty() == c.second);
+                assert(Json::parse(text,err).is_string());
+                err.clear();
+            }
+        }
+        assert(Json::parse("[\"\xc3\xa9\", // c\n]",err,tiny_json::JsonParse::LENIENT_STRICT_UTF8).dump() == "[\"\xc3\xa9\"]");
+        assert(Json::parse("[\"\xc3\x28\"] // c",err,tiny_json::JsonParse::COMMENTS_STRICT_UTF8).is_null());
+        assert(!err.empty());
+        err.clear();
+    }
+    {   // the packed buffer behind a parsed number array
+        auto packed = json.parse("[1,2,3]",err);
+        auto numbers = packed.number_span();
+        std::vector<double> values(numbers.begin(),numbers.end());
+        assert(values == std::vector<double>({1,2,3}));
+    }
+    {   // packed number arrays against generic ones
+        using tiny_json::Json;
+        auto packed = Json::parse("[1,2.5,-0.0,4]",err);
+        auto generic = Json(Json::array{1,2.5,-0.0,4});
+        assert(packed.number_span().size == 4 && generic.number_span().data == nullptr);
+        assert(packed == generic && generic == packed && !(packed < generic) && !(generic < packed));
+        assert(Json::parse("[1,2]",err) < Json::parse("[1,3]",err));
+        assert(Json::parse("[1,2]",err) < Json(Json::array{1,"a"}));
+        assert(!(Json(Json::array{1,"a"}) < Json::parse("[1,2]",err)));
+        assert(packed[0] == Json(1) && packed[0].int_value() == 1 && packed[1].number_value() == 2.5);
+        assert(packed.dump() == "[1,2.5,-0,4]" && packed.array_items().size() == 4);
+        auto mixed = Json::parse("[1,2,\"a\"]",err);
+        assert(mixed.number_span().data == nullptr && mixed[1] == Json(2) && mixed.dump() == "[1,2,\"a\"]");
+        assert(Json::number_array({1.5,2}).dump() == "[1.5,2]");
+    }
+    {   // prerendered values splice their text and compare as the value they wrap
+        using tiny_json::Json;
+        auto schema = Json::parse("{\"type\":\"object\",\"props\":[1,2],\"s\":\"x\\ny\"}",err);
+        auto pre = Json::prerendered(schema);
+        assert(pre.dump() == schema.dump() && pre.is_object() && pre["props"][1] == Json(2));
+        assert(pre == schema && schema == pre && Json::prerendered(pre) == pre);
+        assert(!(pre < schema) && !(schema < pre) && Json(1) < pre);
+        auto envelope = Json(Json::object{{"id",5},{"schema",pre}});
+        assert(envelope.dump() == "{\"id\":5,\"schema\":" + schema.dump() + "}");
+        assert(Json::prerendered(Json(1)) == Json(1.0));
+    }
+    {   // resource limits fail at the first value past the budget, with its offset
+        using tiny_json::Json;
+        tiny_json::JsonLimits limits;
+        limits.max_bytes = 5;
+        assert(Json::parse("[1,2,3]",err,limits).is_null() && err == "input of 7 bytes exceeded max_bytes (5) at offset 0");
+        err.clear();
+        limits = tiny_json::JsonLimits();
+        limits.max_nodes = 3;
+        assert(Json::parse("[1,2]",err,limits).dump() == "[1,2]" && err.empty());
+        assert(Json::parse("[1,2,3]",err,limits).is_null() && err == "exceeded max_nodes (3) at offset 5");
+        err.clear();
+        limits = tiny_json::JsonLimits();
+        limits.max_members = 2;
+        assert(Json::parse("{\"a\":1,\"b\":2,\"c\":3}",err,limits).is_null() && err == "exceeded max_members (2) at offset 17");
+        err.clear();
+        limits = tiny_json::JsonLimits();
+        limits.max_string_bytes = 4;
+        assert(Json::parse("\"abcd\"",err,limits).string_value() == "abcd");
+        assert(Json::parse("\"abcdefghijklmnopqrstuvwxyz\"",err,limits).is_null()
+            && err == "exceeded max_string_bytes (4) at offset 6");
+        err.clear();
+        assert(Json::parse("\"\\n\\n\\n\\n\\n\"",err,limits).is_null() && err == "exceeded max_string_bytes (4) at offset 11");
+        err.clear();
+        limits = tiny_json::JsonLimits();
+        limits.max_alloc_bytes = 1000;
+        // the array is charged first, so the string stops once it outgrows what is left
+        assert(Json::parse("[\"" + std::string(2000,'x') + "\"]",err,limits).is_null()
+            && err == "exceeded max_alloc_bytes (1000) at offset 843");
+        err.clear();
+        assert(Json::parse("{\"a\" 1}",err).is_null() && err == "expected ':' in object, got '1' (49) at offset 6");
+        err.clear();
+    }
+    {   // a reused parser: failures leave nothing behind, moved-from parsers still work
+        using tiny_json::Json;
+        Json::Parser parser;
+        const std::string doc = "{\"a\":[1,2,[3,\"x\"]],\"s\":\"hello\",\"n\":[4,5]}";
+        auto first = parser.parse(doc,err);
+        assert(parser.parse("[1,2,[3,\"x\",[",err).is_null() && !err.empty());
+        err.clear();
+        assert(parser.parse(doc,err) == first && parser.parse(doc,err).dump() == first.dump() && err.empty());
+        auto marks = parser.high_water_marks();
+        assert(marks.string_bytes == 5 && marks.values >= 2 && marks.numbers >= 2);
+        Json::Parser moved = std::move(parser);
+        assert(moved.parse(doc,err) == first);
+        assert(parser.high_water_marks().values == 0 && parser.parse(doc,err) == first);
+        parser.reset();
+        assert(parser.high_water_marks().string_bytes == 0);
+    }
+
     return 0;
 }
\ No newline at end of file